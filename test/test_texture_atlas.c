@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+
+#include "../texture_atlas.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUMBER_OF_THREADS 8
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failures++; \
+		} \
+	} while (0)
+
+static const char* modeNames[] = { "eager", "lazy", "compact", "parallel" };
+
+static char* data_path(const char* dataDirectory, const char* name) {
+	char* path;
+	asprintf(&path, "%s/%s", dataDirectory, name);
+	return path;
+}
+
+/* Reads the whole file into a string, or returns NULL if it could not be read. */
+static char* read_file(const char* filename) {
+	FILE* file = fopen(filename, "r");
+	if (file == NULL)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	char* contents = calloc(size + 1, sizeof(char));
+	if (fread(contents, 1, size, file) != (size_t) size) {
+		free(contents);
+		contents = NULL;
+	}
+
+	fclose(file);
+	return contents;
+}
+
+static char* written_atlas(TextureAtlas_atlas* atlas, const char* filename) {
+	TextureAtlas_write(atlas, filename);
+	char* contents = read_file(filename);
+	unlink(filename);
+	return contents;
+}
+
+static void test_mode(const char* dataDirectory, TextureAtlas_mode mode, const char* eagerOutput) {
+	char* path = data_path(dataDirectory, "test.atlas");
+	TextureAtlas_atlas* atlas = TextureAtlas_readWithMode(path, mode);
+	free(path);
+
+	CHECK(atlas != NULL);
+	if (atlas == NULL)
+		return;
+
+	CHECK(atlas->numberOfPages == 2);
+
+	// Every mode must write the atlas back exactly like the eager reader does
+	char filename[64];
+	snprintf(filename, sizeof(filename), "test_%s.atlas", modeNames[mode]);
+	char* output = written_atlas(atlas, filename);
+	CHECK(output != NULL && strcmp(output, eagerOutput) == 0);
+	free(output);
+
+	const char* names[] = { "hero_walk", "missing", "sky", "button" };
+
+	if (mode == TextureAtlas_COMPACT) {
+		TextureAtlas_unpackedRegion unpacked[4];
+		CHECK(TextureAtlas_findCompactRegions(atlas, names, 4, unpacked) == 1);
+		CHECK(unpacked[0].region.index == 0 && unpacked[0].region.rotate);
+		CHECK(unpacked[1].region.name == NULL);
+		CHECK(unpacked[2].region.originalWidth == 100000 && unpacked[2].region.page->index == 1);
+		CHECK(unpacked[3].region.splits != NULL && unpacked[3].splits[3] == 5 && unpacked[3].pads[0] == 2);
+
+		TextureAtlas_unpackedRegion single;
+		CHECK(TextureAtlas_findCompactRegion(atlas, "hero_idle", &single) && single.region.height == 96);
+		CHECK(!TextureAtlas_findCompactRegion(atlas, "missing", &single));
+
+		// Compact atlases have no region structures to hand out
+		TextureAtlas_region* regions[4];
+		CHECK(TextureAtlas_findRegion(atlas, "sky") == NULL);
+		CHECK(TextureAtlas_findRegions(atlas, names, 4, regions) == -1);
+	} else {
+		TextureAtlas_region* regions[4];
+		CHECK(TextureAtlas_findRegions(atlas, names, 4, regions) == 1);
+		CHECK(regions[0] != NULL && regions[0]->index == 0 && regions[0]->rotate);
+		CHECK(regions[1] == NULL);
+		CHECK(regions[2] != NULL && regions[2]->originalWidth == 100000 && regions[2]->page->index == 1);
+		CHECK(regions[3] != NULL && regions[3]->splits != NULL && regions[3]->splits[3] == 5 && regions[3]->pads[0] == 2);
+
+		for (int i = 0; i < 4; i++)
+			CHECK(TextureAtlas_findRegion(atlas, (char*) names[i]) == regions[i]);
+
+		TextureAtlas_unpackedRegion unpacked[4];
+		CHECK(!TextureAtlas_findCompactRegion(atlas, "sky", &unpacked[0]));
+		CHECK(TextureAtlas_findCompactRegions(atlas, names, 4, unpacked) == -1);
+	}
+
+	CHECK(TextureAtlas_memoryUsage(atlas) > 0);
+
+	TextureAtlas_cleanup(atlas);
+}
+
+static void test_modes(const char* dataDirectory) {
+	char* path = data_path(dataDirectory, "test.atlas");
+	TextureAtlas_atlas* atlas = TextureAtlas_read(path);
+	CHECK(atlas != NULL);
+	char* eagerOutput = written_atlas(atlas, "test_read.atlas");
+	TextureAtlas_cleanup(atlas);
+	CHECK(eagerOutput != NULL);
+
+	for (int mode = TextureAtlas_EAGER; mode <= TextureAtlas_PARALLEL; mode++)
+		test_mode(dataDirectory, mode, eagerOutput);
+
+	free(eagerOutput);
+
+	// Broken and missing files are rejected by every mode that validates while reading
+	char* badPath = data_path(dataDirectory, "bad.atlas");
+	CHECK(TextureAtlas_readWithMode(badPath, TextureAtlas_EAGER) == NULL);
+	CHECK(TextureAtlas_readWithMode(badPath, TextureAtlas_COMPACT) == NULL);
+	CHECK(TextureAtlas_readWithMode(badPath, TextureAtlas_PARALLEL) == NULL);
+
+	// The lazy reader only finds out once the broken region is looked up
+	atlas = TextureAtlas_readWithMode(badPath, TextureAtlas_LAZY);
+	CHECK(atlas != NULL && TextureAtlas_findRegion(atlas, "region") == NULL);
+	TextureAtlas_cleanup(atlas);
+	free(badPath);
+
+	for (int mode = TextureAtlas_EAGER; mode <= TextureAtlas_PARALLEL; mode++)
+		CHECK(TextureAtlas_readWithMode("missing.atlas", mode) == NULL);
+	free(path);
+}
+
+typedef struct TextureAtlas_acquireJob {
+	TextureAtlas_registry* registry;
+	const char* filename;
+	TextureAtlas_atlas* atlas;
+} TextureAtlas_acquireJob;
+
+static void* acquire_atlas(void* argument) {
+	TextureAtlas_acquireJob* job = argument;
+	job->atlas = TextureAtlas_acquire(job->registry, job->filename);
+	return NULL;
+}
+
+/* Acquires the file on many threads at once. Returns the atlas if every thread got the same one. */
+static TextureAtlas_atlas* acquire_concurrently(TextureAtlas_registry* registry, const char* filename) {
+	pthread_t threads[NUMBER_OF_THREADS];
+	TextureAtlas_acquireJob jobs[NUMBER_OF_THREADS];
+
+	for (int i = 0; i < NUMBER_OF_THREADS; i++) {
+		jobs[i].registry = registry;
+		jobs[i].filename = filename;
+		pthread_create(&threads[i], NULL, acquire_atlas, &jobs[i]);
+	}
+
+	bool same = true;
+	for (int i = 0; i < NUMBER_OF_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+		same = same && jobs[i].atlas == jobs[0].atlas;
+	}
+
+	return same ? jobs[0].atlas : NULL;
+}
+
+typedef struct TextureAtlas_registryCount {
+	int atlases;
+	int references;
+} TextureAtlas_registryCount;
+
+static void count_atlas(const char* path, int references, size_t memoryUsage, void* userData) {
+	TextureAtlas_registryCount* count = userData;
+	count->atlases++;
+	count->references += references;
+	(void) path;
+	(void) memoryUsage;
+}
+
+static TextureAtlas_registryCount count_registry(TextureAtlas_registry* registry) {
+	TextureAtlas_registryCount count = { 0, 0 };
+	TextureAtlas_reportRegistry(registry, count_atlas, &count);
+	return count;
+}
+
+static void find_path(const char* path, int references, size_t memoryUsage, void* userData) {
+	char* wanted = userData;
+	if (strcmp(path, wanted) == 0)
+		wanted[0] = '\0';
+	(void) references;
+	(void) memoryUsage;
+}
+
+/* True if the registry holds an atlas for the file. */
+static bool registry_contains(TextureAtlas_registry* registry, const char* filename) {
+	char path[PATH_MAX];
+	if (realpath(filename, path) == NULL)
+		return false;
+	TextureAtlas_reportRegistry(registry, find_path, path);
+	return path[0] == '\0';
+}
+
+static void test_registry(const char* dataDirectory, TextureAtlas_mode mode) {
+	char* path = data_path(dataDirectory, "test.atlas");
+	TextureAtlas_registry* registry = TextureAtlas_createRegistry(0, mode);
+
+	// Concurrent acquires share one atlas, parsed once
+	TextureAtlas_atlas* atlas = acquire_concurrently(registry, path);
+	CHECK(atlas != NULL);
+	TextureAtlas_registryCount count = count_registry(registry);
+	CHECK(count.atlases == 1 && count.references == NUMBER_OF_THREADS);
+	CHECK(TextureAtlas_registryMemoryUsage(registry) == TextureAtlas_memoryUsage(atlas));
+
+	// Lookups grow lazy atlases and build the index of eager ones, which the registry picks up on release
+	if (mode != TextureAtlas_COMPACT)
+		CHECK(TextureAtlas_findRegion(atlas, "button") != NULL);
+
+	for (int i = 0; i < NUMBER_OF_THREADS - 1; i++)
+		TextureAtlas_release(registry, atlas);
+	CHECK(count_registry(registry).references == 1);
+
+	TextureAtlas_setMemoryBudget(registry, (size_t) -1);
+	TextureAtlas_release(registry, atlas);
+	CHECK(count_registry(registry).atlases == 1);
+	CHECK(TextureAtlas_registryMemoryUsage(registry) == TextureAtlas_memoryUsage(atlas));
+
+	// Unreferenced atlases are evicted as soon as the budget is exceeded
+	TextureAtlas_setMemoryBudget(registry, 0);
+	CHECK(count_registry(registry).atlases == 0);
+	CHECK(TextureAtlas_registryMemoryUsage(registry) == 0);
+
+	// Failed loads hand out NULL to everyone waiting and leave nothing behind
+	if (mode != TextureAtlas_LAZY) {
+		char* badPath = data_path(dataDirectory, "bad.atlas");
+		CHECK(acquire_concurrently(registry, badPath) == NULL);
+		CHECK(count_registry(registry).atlases == 0);
+		free(badPath);
+	}
+	CHECK(TextureAtlas_acquire(registry, "missing.atlas") == NULL);
+	CHECK(count_registry(registry).atlases == 0);
+
+	TextureAtlas_destroyRegistry(registry);
+	free(path);
+}
+
+static void test_eviction_order(const char* dataDirectory) {
+	char* path = data_path(dataDirectory, "test.atlas");
+	TextureAtlas_atlas* source = TextureAtlas_read(path);
+	free(path);
+	CHECK(source != NULL);
+	if (source == NULL)
+		return;
+
+	// Copies of the same atlas in the same directory, so each of them uses the same amount of memory
+	const char* copies[] = { "test_copy_0.atlas", "test_copy_1.atlas", "test_copy_2.atlas" };
+	for (int i = 0; i < 3; i++)
+		TextureAtlas_write(source, copies[i]);
+	TextureAtlas_cleanup(source);
+
+	TextureAtlas_atlas* copy = TextureAtlas_read(copies[0]);
+	size_t atlasSize = TextureAtlas_memoryUsage(copy);
+	TextureAtlas_cleanup(copy);
+
+	TextureAtlas_registry* registry = TextureAtlas_createRegistry(atlasSize * 2, TextureAtlas_EAGER);
+
+	TextureAtlas_atlas* atlases[3];
+	for (int i = 0; i < 2; i++) {
+		atlases[i] = TextureAtlas_acquire(registry, copies[i]);
+		CHECK(atlases[i] != NULL);
+	}
+
+	// Release the second one first, then use the first again, so the second is least recently used
+	TextureAtlas_release(registry, atlases[1]);
+	TextureAtlas_release(registry, atlases[0]);
+	CHECK(TextureAtlas_acquire(registry, copies[0]) == atlases[0]);
+	TextureAtlas_release(registry, atlases[0]);
+	CHECK(count_registry(registry).atlases == 2);
+
+	// Loading a third atlas goes over budget and evicts the least recently used one
+	atlases[2] = TextureAtlas_acquire(registry, copies[2]);
+	CHECK(atlases[2] != NULL);
+	CHECK(count_registry(registry).atlases == 2);
+	CHECK(registry_contains(registry, copies[0]) && !registry_contains(registry, copies[1]));
+	CHECK(TextureAtlas_registryMemoryUsage(registry) == atlasSize * 2);
+
+	// Lowering the budget evicts right away
+	TextureAtlas_setMemoryBudget(registry, atlasSize);
+	CHECK(count_registry(registry).atlases == 1 && registry_contains(registry, copies[2]));
+
+	// Referenced atlases are never evicted, even when over budget
+	TextureAtlas_setMemoryBudget(registry, 0);
+	CHECK(count_registry(registry).atlases == 1);
+	TextureAtlas_release(registry, atlases[2]);
+	CHECK(count_registry(registry).atlases == 0);
+
+	TextureAtlas_destroyRegistry(registry);
+
+	for (int i = 0; i < 3; i++)
+		unlink(copies[i]);
+}
+
+int main(int argc, char** argv) {
+	const char* dataDirectory = argc > 1 ? argv[1] : "test/data";
+
+	test_modes(dataDirectory);
+
+	for (int mode = TextureAtlas_EAGER; mode <= TextureAtlas_PARALLEL; mode++)
+		test_registry(dataDirectory, mode);
+
+	test_eviction_order(dataDirectory);
+
+	if (failures > 0) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All tests passed\n");
+	return EXIT_SUCCESS;
+}
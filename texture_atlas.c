@@ -28,8 +28,16 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define BUFFER_SIZE 1024
+
+/* Number of names TextureAtlas_findRegions hashes and prefetches ahead of probing. */
+#define LOOKUP_BATCH_SIZE 16
 static const char* FORMAT_RGBA8888 = "RGBA8888";
 static const char* FORMAT_RGB888 = "RGB888";
 static const char* FORMAT_RGBA4444 = "RGBA4444";
@@ -208,6 +216,241 @@ bool parse_attribute(ssize_t charactersRead, char* lineBuffer, char* attribute,
 	return true;
 }
 
+/* Finds the next line in a buffer, including the newline. Returns false once the buffer is exhausted. */
+static bool next_line(char** cursor, char* end, char** line, ssize_t* charactersRead) {
+	if (*cursor >= end)
+		return false;
+
+	char* newline = memchr(*cursor, '\n', end - *cursor);
+	char* next = newline != NULL ? newline + 1 : end;
+
+	*line = *cursor;
+	*charactersRead = next - *cursor;
+	*cursor = next;
+	return true;
+}
+
+/* Copies a line out of a buffer, so it is zero terminated like the lines returned by getline. */
+static char* copy_line(char* line, ssize_t* charactersRead, char* lineBuffer) {
+	if (*charactersRead > BUFFER_SIZE - 1)
+		*charactersRead = BUFFER_SIZE - 1;
+
+	memcpy(lineBuffer, line, *charactersRead);
+	lineBuffer[*charactersRead] = 0;
+	return lineBuffer;
+}
+
+/* Returns the absolute path of the directory containing the atlas file. */
+static char* atlas_directory(const char* filename) {
+	char* absPathToAtlas = realpath(filename, NULL);
+	char* absPathToDir = strdup(dirname(absPathToAtlas));
+	free(absPathToAtlas);
+	return absPathToDir;
+}
+
+static TextureAtlas_page* create_page(int index) {
+	// Create page, and initialized to a known invalid state
+	TextureAtlas_page* page = malloc(sizeof(TextureAtlas_page));
+	page->index = index;
+	page->name = NULL;
+	page->next = NULL;
+	page->absolutePath = NULL;
+	page->width = page->height = -1;
+	page->format = TextureAtlas_UNDEFINED_FORMAT;
+	page->repeat = TextureAtlas_UNDEFINED_REPEAT;
+	page->minificationFilter = TextureAtlas_UNDEFINED_FILTER;
+	page->magnificationFilter = TextureAtlas_UNDEFINED_FILTER;
+	page->firstRegion = NULL;
+	return page;
+}
+
+static TextureAtlas_region* create_region(TextureAtlas_page* page) {
+	// Create region to fill, and initialize to known default/invalid state.
+	TextureAtlas_region* region = malloc(sizeof(TextureAtlas_region));
+	region->page = page;
+	region->name = NULL;
+	region->width = -1;
+	region->height = -1;
+	region->index = -1;
+	region->offsetX = -1;
+	region->offsetY = -1;
+	region->originalHeight = -1;
+	region->originalWidth = -1;
+	region->pads = NULL;
+	region->rotate = false;
+	region->splits = NULL;
+	region->x = -1;
+	region->y = -1;
+	region->nextRegion = NULL;
+	return region;
+}
+
+/* Applies a single page header attribute. Prints the problem and returns false if the value is invalid. */
+static bool parse_page_attribute(TextureAtlas_page* page, char* attribute, char* value) {
+	if (strcmp(attribute, "size") == 0) {
+		unsigned int width, height;
+		if (sscanf(value, "%u, %u", &width, &height) == 2) {
+			page->width = width;
+			page->height = width;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Could not read two size tokens: '%s'\n", value);
+		}
+	} else if (strcmp(attribute, "format") == 0) {
+		if (strcmp(value, FORMAT_ALPHA) == 0) {
+			page->format = TextureAtlas_ALPHA;
+		} else if (strcmp(value, FORMAT_INTENSITY) == 0) {
+			page->format = TextureAtlas_INTENSITY;
+		} else if (strcmp(value, FORMAT_LUMINANCE_ALPHA) == 0) {
+			page->format = TextureAtlas_LUMINANCE_ALPHA;
+		} else if (strcmp(value, FORMAT_RGB565) == 0) {
+			page->format = TextureAtlas_RGB565;
+		} else if (strcmp(value, FORMAT_RGBA4444) == 0) {
+			page->format = TextureAtlas_RGBA4444;
+		} else if (strcmp(value, FORMAT_RGB888) == 0) {
+			page->format = TextureAtlas_RGB888;
+		} else if (strcmp(value, FORMAT_RGBA8888) == 0) {
+			page->format = TextureAtlas_RGBA8888;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Unknown 'format' value: '%s'\n", value);
+		}
+	} else if (strcmp(attribute, "filter") == 0) {
+
+		/* Get the texture minification and magnification filters */
+		char* separator = strchr(value, ',');
+		if (separator != NULL) {
+			*separator = 0;
+			char* firstValue = value;
+			char* lastValue = separator + 1;
+
+			if (isspace(*lastValue))
+				lastValue++;
+
+			int lastLength = strlen(lastValue);
+			if (lastValue[lastLength - 1] == '\n') {
+				lastValue[lastLength - 1] = 0;
+			}
+
+			enum TextureAtlas_filter minFilter;
+			enum TextureAtlas_filter magFilter;
+			bool success = parse_filter_value(firstValue, &minFilter);
+			success = success && parse_filter_value(lastValue, &magFilter);
+
+			if (!success)
+				return false;
+
+			page->minificationFilter = minFilter;
+			page->magnificationFilter = magFilter;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Could not read two filter tokens: '%s'\n", value);
+		}
+	} else if (strcmp(attribute, "repeat") == 0) {
+		if (strcmp(value, REPEAT_X) == 0) {
+			page->repeat = TextureAtlas_X;
+		} else if (strcmp(value, REPEAT_Y) == 0) {
+			page->repeat = TextureAtlas_Y;
+		} else if (strcmp(value, REPEAT_XY) == 0) {
+			page->repeat = TextureAtlas_XY;
+		} else if (strcmp(value, REPEAT_NONE) == 0) {
+			page->repeat = TextureAtlas_NONE;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Unknown 'repeat' value: '%s'\n", value);
+		}
+	}
+	return true;
+}
+
+/* Checks that every field in the page has been correctly initialized */
+static bool validate_page(TextureAtlas_page* page, const char* filename) {
+	if (page->name == NULL)
+		return display_error(NULL, "'name' value not set in TextureAtlas page in file: '%s'\n", filename);
+	if (page->width == -1 || page->height == -1)
+		return display_error(NULL, "'size' value not properly set in TextureAtlas page '%s' in file: '%s'.\n", page->name, filename);
+	if (page->format == TextureAtlas_UNDEFINED_FORMAT)
+		return display_error(NULL, "'format' value not properly set in TextureAtlas page '%s' in file: '%s'.\n", page->name, filename);
+	if (page->repeat == TextureAtlas_UNDEFINED_REPEAT)
+		return display_error(NULL, "'repeat' value not properly set in TextureAtlas page '%s' in file: '%s'.\n", page->name, filename);
+	if (page->minificationFilter == TextureAtlas_UNDEFINED_FILTER || page->magnificationFilter == TextureAtlas_UNDEFINED_FILTER)
+		return display_error(NULL, "'filter' value not properly set in TextureAtlas page '%s' in file: '%s'.\n", page->name, filename);
+	return true;
+}
+
+/* Applies a single region attribute. Prints the problem and returns false if the value is invalid. */
+static bool parse_region_attribute(TextureAtlas_region* region, char* attribute, char* value) {
+	if (strcmp(attribute, "rotate") == 0) {
+		if (strcmp(value, "false") == 0) {
+			region->rotate = false;
+		} else if (strcmp(value, "true") == 0) {
+			region->rotate = true;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Unknown value in 'rotate' token: '%s'\n", value);
+		}
+	} else if (strcmp(attribute, REPEAT_XY) == 0) {
+		unsigned int x, y;
+		if (sscanf(value, "%u, %u", &x, &y) == 2) {
+			region->x = x;
+			region->y = y;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Could not read 'xy' token: '%s'\n", value);
+		}
+	} else if (strcmp(attribute, "size") == 0) {
+		unsigned int width, height;
+		if (sscanf(value, "%u, %u", &width, &height) == 2) {
+			region->width = width;
+			region->height = height;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Could not read 'size' token: '%s'\n", value);
+		}
+	} else if (strcmp(attribute, "orig") == 0) {
+		unsigned int width, height;
+		if (sscanf(value, "%u, %u", &width, &height) == 2) {
+			region->originalWidth = width;
+			region->originalHeight = height;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Could not read 'orig' token: '%s'\n", value);
+		}
+	} else if (strcmp(attribute, "offset") == 0) {
+		unsigned int offsetX, offsetY;
+		if (sscanf(value, "%u, %u", &offsetX, &offsetY) == 2) {
+			region->offsetX = offsetX;
+			region->offsetY = offsetY;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Could not read 'offset' token: '%s'\n", value);
+		}
+	} else if (strcmp(attribute, "index") == 0) {
+		unsigned int index;
+		if (sscanf(value, "%u", &index) == 1) {
+			region->index = index;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Could not read 'index' token: '%s'\n", value);
+		}
+	} else if (strcmp(attribute, "split") == 0) {
+		unsigned int v1, v2, v3, v4;
+		if (sscanf(value, "%u, %u, %u, %u", &v1, &v2, &v3, &v4) == 4) {
+			int* splits = region->splits != NULL ? region->splits : malloc(sizeof(int) * 4);
+			splits[0] = v1;
+			splits[1] = v2;
+			splits[2] = v3;
+			splits[3] = v4;
+			region->splits = splits;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Could not read 'split' token: '%s'\n", value);
+		}
+	} else if (strcmp(attribute, "pad") == 0) {
+		unsigned int v1, v2, v3, v4;
+		if (sscanf(value, "%u, %u, %u, %u", &v1, &v2, &v3, &v4) == 4) {
+			int* pads = region->pads != NULL ? region->pads : malloc(sizeof(int) * 4);
+			pads[0] = v1;
+			pads[1] = v2;
+			pads[2] = v3;
+			pads[3] = v4;
+			region->pads = pads;
+		} else {
+			return display_error(NULL, "ERROR. TextureAtlas: Could not read 'pad' token: '%s'\n", value);
+		}
+	}
+	return true;
+}
+
 void freeRegion(TextureAtlas_region* region) {
 	if (region == NULL)
 		return;
@@ -250,12 +493,402 @@ void freePage(TextureAtlas_page* page) {
 	freePage(next);
 }
 
+typedef struct TextureAtlas_lazyRegion {
+	/* The page the region belongs to. */
+	TextureAtlas_page* page;
+
+	/* Where the region name starts in the file, and where its last attribute line ends. */
+	size_t nameOffset, end;
+
+	/* Length of the region name, without the newline. */
+	int nameLength;
+
+	/* Set if the attributes could not be parsed, so we do not retry on every lookup. */
+	bool failed;
+
+	/* The parsed region, or NULL until it is first looked up. */
+	TextureAtlas_region* region;
+} TextureAtlas_lazyRegion;
+
+/* Flags of a compact region */
+#define COMPACT_ROTATE 1
+#define COMPACT_SPLITS 2
+#define COMPACT_PADS 4
+
+/* Largest value stored in a narrow value pool. Values are stored plus one, so -1 fits as well. */
+#define COMPACT_NARROW_MAX 65534
+
+typedef struct TextureAtlas_compactRegion {
+	/* Offset of the zero terminated name in the string pool. */
+	unsigned int nameOffset;
+
+	/* Offset of the first value in the value pool. The values are x, y, width, height,
+	 * originalWidth, originalHeight, offsetX, offsetY and index, followed by the
+	 * splits and pads if the flags say the region has them. */
+	unsigned int valueOffset;
+
+	/* 0 based index of the page. */
+	unsigned short page;
+
+	/* COMPACT_ROTATE, COMPACT_SPLITS and COMPACT_PADS. */
+	unsigned char flags;
+} TextureAtlas_compactRegion;
+
+/* Number of values every compact region has in the value pool. */
+#define COMPACT_VALUES 9
+
+typedef struct TextureAtlas_bucket {
+	/* Hash of the region name. */
+	unsigned int hash;
+
+	/* Region number plus one, 0 marking an empty bucket. */
+	int region;
+} TextureAtlas_bucket;
+
+typedef struct TextureAtlas_internal {
+	enum TextureAtlas_mode mode;
+
+	/* The memory mapped atlas file, kept around for parsing regions on demand. */
+	char* data;
+	size_t dataSize;
+
+	/* Every region in the file, in the order they appear. */
+	TextureAtlas_lazyRegion* lazyRegions;
+	int numberOfLazyRegions;
+
+	/* Compact regions in file order, with their names and values stored in shared pools. */
+	TextureAtlas_compactRegion* compactRegions;
+	int numberOfCompactRegions;
+	char* stringPool;
+	size_t stringPoolSize;
+
+	/* Unsigned shorts holding the value plus one while every value fits, ints otherwise. */
+	void* values;
+	bool wideValues;
+	size_t numberOfValues, valueCapacity;
+
+	/* The pages, so compact regions can refer to them by index. */
+	TextureAtlas_page** pages;
+
+	/* Every region of an eagerly read atlas, in file order. */
+	TextureAtlas_region** regions;
+	int numberOfRegions;
+
+	/* Open addressing hash table of the region names. The number of buckets is always a power of two. */
+	TextureAtlas_bucket* buckets;
+	int numberOfBuckets;
+
+	/* Bytes allocated by lookups after reading, for parsed lazy regions and the eager name index.
+	 * Only ever grows, so the registry can account for it without walking the atlas. */
+	size_t grownBytes;
+
+	/* Serializes parsing of lazy regions. */
+	pthread_mutex_t lock;
+} TextureAtlas_internal;
+
+/* FNV-1a hash of a region name. */
+static unsigned int hash_name(const char* name, size_t length) {
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char) name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* Start of a region's name by number, in whatever way the mode stores it. Not zero terminated in lazy mode. */
+static const char* name_start(TextureAtlas_internal* internal, int region) {
+	if (internal->mode == TextureAtlas_LAZY)
+		return internal->data + internal->lazyRegions[region].nameOffset;
+	else if (internal->mode == TextureAtlas_COMPACT)
+		return internal->stringPool + internal->compactRegions[region].nameOffset;
+	else
+		return internal->regions[region]->name;
+}
+
+/* Name and length of a region by number. */
+static const char* indexed_name(TextureAtlas_internal* internal, int region, size_t* length) {
+	const char* name = name_start(internal, region);
+	if (internal->mode == TextureAtlas_LAZY)
+		*length = internal->lazyRegions[region].nameLength;
+	else
+		*length = strlen(name);
+	return name;
+}
+
+/* Address of the record holding the region's name, for prefetching. */
+static const void* indexed_record(TextureAtlas_internal* internal, int region) {
+	if (internal->mode == TextureAtlas_LAZY)
+		return &internal->lazyRegions[region];
+	else if (internal->mode == TextureAtlas_COMPACT)
+		return &internal->compactRegions[region];
+	else
+		return &internal->regions[region];
+}
+
+static bool bucket_matches(TextureAtlas_internal* internal, TextureAtlas_bucket* bucket, const char* name, size_t length, unsigned int hash) {
+	if (bucket->hash != hash)
+		return false;
+
+	const char* other = name_start(internal, bucket->region - 1);
+	if (internal->mode == TextureAtlas_LAZY)
+		return internal->lazyRegions[bucket->region - 1].nameLength == (int) length && memcmp(other, name, length) == 0;
+
+	// The other names are zero terminated, so there is no need to measure them first
+	return strncmp(other, name, length) == 0 && other[length] == 0;
+}
+
+static void build_index(TextureAtlas_internal* internal, int numberOfRegions) {
+	int numberOfBuckets = 16;
+	while (numberOfBuckets < numberOfRegions * 2)
+		numberOfBuckets *= 2;
+
+	TextureAtlas_bucket* buckets = calloc(numberOfBuckets, sizeof(TextureAtlas_bucket));
+
+	for (int i = 0; i < numberOfRegions; i++) {
+		size_t length;
+		const char* name = indexed_name(internal, i, &length);
+		unsigned int hash = hash_name(name, length);
+		unsigned int bucket = hash & (numberOfBuckets - 1);
+
+		// Names may repeat, e.g. for animation frames. Keep the first one, like TextureAtlas_findRegion.
+		while (buckets[bucket].region != 0 && !bucket_matches(internal, &buckets[bucket], name, length, hash))
+			bucket = (bucket + 1) & (numberOfBuckets - 1);
+
+		if (buckets[bucket].region == 0) {
+			buckets[bucket].hash = hash;
+			buckets[bucket].region = i + 1;
+		}
+	}
+
+	// Publish the buckets last, lookups on other threads take a non NULL table as complete
+	internal->numberOfBuckets = numberOfBuckets;
+	__atomic_store_n(&internal->buckets, buckets, __ATOMIC_RELEASE);
+}
+
+static int probe_index(TextureAtlas_internal* internal, const char* name, size_t length, unsigned int hash) {
+	unsigned int bucket = hash & (internal->numberOfBuckets - 1);
+
+	while (internal->buckets[bucket].region != 0) {
+		if (bucket_matches(internal, &internal->buckets[bucket], name, length, hash))
+			return internal->buckets[bucket].region - 1;
+		bucket = (bucket + 1) & (internal->numberOfBuckets - 1);
+	}
+	return -1;
+}
+
+/* Returns the number of the first region with the name, or -1 if there is none. */
+static int find_in_index(TextureAtlas_internal* internal, const char* name) {
+	size_t length = strlen(name);
+	return probe_index(internal, name, length, hash_name(name, length));
+}
+
+/* Looks up many names at once, storing region numbers or -1 in 'regions'. Returns the number of misses.
+ *
+ * Names are handled in batches. All names in a batch are hashed and their buckets prefetched,
+ * then the records of the candidate regions in those buckets, then their names, and only then
+ * are the buckets probed. Each step only reads memory the step before prefetched, so the cache
+ * misses of a whole batch overlap, rather than being paid one by one. */
+static int find_many_in_index(TextureAtlas_internal* internal, const char** names, int numberOfNames, int* regions) {
+	size_t lengths[LOOKUP_BATCH_SIZE];
+	unsigned int hashes[LOOKUP_BATCH_SIZE];
+	int candidates[LOOKUP_BATCH_SIZE];
+	unsigned int mask = internal->numberOfBuckets - 1;
+	int misses = 0;
+
+	for (int first = 0; first < numberOfNames; first += LOOKUP_BATCH_SIZE) {
+		int batchSize = numberOfNames - first < LOOKUP_BATCH_SIZE ? numberOfNames - first : LOOKUP_BATCH_SIZE;
+
+		for (int i = 0; i < batchSize; i++) {
+			lengths[i] = strlen(names[first + i]);
+			hashes[i] = hash_name(names[first + i], lengths[i]);
+			__builtin_prefetch(&internal->buckets[hashes[i] & mask]);
+		}
+
+		for (int i = 0; i < batchSize; i++) {
+			TextureAtlas_bucket* bucket = &internal->buckets[hashes[i] & mask];
+			candidates[i] = bucket->region != 0 && bucket->hash == hashes[i] ? bucket->region - 1 : -1;
+			if (candidates[i] != -1)
+				__builtin_prefetch(indexed_record(internal, candidates[i]));
+		}
+
+		// Eager regions keep their names behind the region structure, which is one more step
+		if (internal->mode == TextureAtlas_EAGER) {
+			for (int i = 0; i < batchSize; i++)
+				if (candidates[i] != -1)
+					__builtin_prefetch(internal->regions[candidates[i]]);
+		}
+
+		for (int i = 0; i < batchSize; i++)
+			if (candidates[i] != -1)
+				__builtin_prefetch(name_start(internal, candidates[i]));
+
+		for (int i = 0; i < batchSize; i++) {
+			regions[first + i] = probe_index(internal, names[first + i], lengths[i], hashes[i]);
+			if (regions[first + i] == -1)
+				misses++;
+		}
+	}
+
+	return misses;
+}
+
+static void report_region(TextureAtlas_region* region, TextureAtlas_memoryReport* report) {
+	report->regions += sizeof(TextureAtlas_region);
+	if (region->name != NULL)
+		report->names += strlen(region->name) + 1;
+	if (region->splits != NULL)
+		report->splitsAndPads += sizeof(int) * 4;
+	if (region->pads != NULL)
+		report->splitsAndPads += sizeof(int) * 4;
+}
+
+/* Bytes used by a parsed region, the same as TextureAtlas_reportMemory counts for it. */
+static size_t region_memory(TextureAtlas_region* region) {
+	TextureAtlas_memoryReport report;
+	memset(&report, 0, sizeof(TextureAtlas_memoryReport));
+	report_region(region, &report);
+	return report.regions + report.names + report.splitsAndPads;
+}
+
+static TextureAtlas_region* parse_lazy_region(TextureAtlas_internal* internal, TextureAtlas_lazyRegion* lazyRegion) {
+	TextureAtlas_region* region = create_region(lazyRegion->page);
+	region->name = strndup(internal->data + lazyRegion->nameOffset, lazyRegion->nameLength);
+
+	char* cursor = internal->data + lazyRegion->nameOffset + lazyRegion->nameLength;
+	char* end = internal->data + lazyRegion->end;
+	char* line;
+	ssize_t charactersRead;
+
+	// Skip what is left of the name line
+	next_line(&cursor, end, &line, &charactersRead);
+
+	while (next_line(&cursor, end, &line, &charactersRead)) {
+		char lineBuffer[BUFFER_SIZE];
+		char attribute[BUFFER_SIZE];
+		char value[BUFFER_SIZE];
+
+		copy_line(line, &charactersRead, lineBuffer);
+		if (!parse_attribute(charactersRead, lineBuffer, attribute, value, 2) || !parse_region_attribute(region, attribute, value)) {
+			display_error(NULL, "ERROR. TextureAtlas: Could not parse region '%s'.\n", region->name);
+			freeRegion(region);
+			return NULL;
+		}
+	}
+
+	return region;
+}
+
+/* Returns the parsed region, parsing it first if nobody has looked it up before. */
+static TextureAtlas_region* load_lazy_region(TextureAtlas_internal* internal, TextureAtlas_lazyRegion* lazyRegion) {
+	TextureAtlas_region* region = __atomic_load_n(&lazyRegion->region, __ATOMIC_ACQUIRE);
+	if (region != NULL)
+		return region;
+
+	pthread_mutex_lock(&internal->lock);
+
+	// Check again, someone may have parsed it while we waited for the lock
+	region = lazyRegion->region;
+	if (region == NULL && !lazyRegion->failed) {
+		region = parse_lazy_region(internal, lazyRegion);
+		lazyRegion->failed = region == NULL;
+		if (region != NULL)
+			__atomic_add_fetch(&internal->grownBytes, region_memory(region), __ATOMIC_RELAXED);
+		__atomic_store_n(&lazyRegion->region, region, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&internal->lock);
+
+	return region;
+}
+
+static void freeInternal(TextureAtlas_internal* internal) {
+	if (internal == NULL)
+		return;
+
+	for (int i = 0; i < internal->numberOfLazyRegions; i++)
+		freeRegion(internal->lazyRegions[i].region);
+
+	free(internal->lazyRegions);
+	free(internal->compactRegions);
+	free(internal->stringPool);
+	free(internal->values);
+	free(internal->pages);
+	free(internal->regions);
+	free(internal->buckets);
+
+	if (internal->data != NULL)
+		munmap(internal->data, internal->dataSize);
+
+	pthread_mutex_destroy(&internal->lock);
+	free(internal);
+}
+
+static int compact_value(TextureAtlas_internal* internal, size_t offset) {
+	if (internal->wideValues)
+		return ((int*) internal->values)[offset];
+	else
+		return (int) ((unsigned short*) internal->values)[offset] - 1;
+}
+
+static void unpack_region(TextureAtlas_internal* internal, int number, TextureAtlas_unpackedRegion* unpacked) {
+	TextureAtlas_compactRegion* compactRegion = &internal->compactRegions[number];
+	TextureAtlas_region* region = &unpacked->region;
+	size_t offset = compactRegion->valueOffset;
+
+	region->page = internal->pages[compactRegion->page];
+	region->name = internal->stringPool + compactRegion->nameOffset;
+	region->rotate = (compactRegion->flags & COMPACT_ROTATE) != 0;
+	region->x = compact_value(internal, offset++);
+	region->y = compact_value(internal, offset++);
+	region->width = compact_value(internal, offset++);
+	region->height = compact_value(internal, offset++);
+	region->originalWidth = compact_value(internal, offset++);
+	region->originalHeight = compact_value(internal, offset++);
+	region->offsetX = compact_value(internal, offset++);
+	region->offsetY = compact_value(internal, offset++);
+	region->index = compact_value(internal, offset++);
+
+	region->splits = NULL;
+	if (compactRegion->flags & COMPACT_SPLITS) {
+		for (int i = 0; i < 4; i++)
+			unpacked->splits[i] = compact_value(internal, offset++);
+		region->splits = unpacked->splits;
+	}
+
+	region->pads = NULL;
+	if (compactRegion->flags & COMPACT_PADS) {
+		for (int i = 0; i < 4; i++)
+			unpacked->pads[i] = compact_value(internal, offset++);
+		region->pads = unpacked->pads;
+	}
+
+	region->nextRegion = NULL;
+}
+
+static void write_region(FILE* destination, TextureAtlas_region* region) {
+	fprintf(destination, "%s\n", region->name);
+	fprintf(destination, "  rotate: %s\n", region->rotate ? "true" : "false");
+	fprintf(destination, "  xy: %i, %i\n", region->x, region->y);
+	fprintf(destination, "  size: %i, %i\n", region->width, region->height);
+	if (region->splits != NULL)
+		fprintf(destination, "  split: %i, %i, %i, %i\n", region->splits[0], region->splits[1], region->splits[2], region->splits[3]);
+	if (region->pads != NULL)
+		fprintf(destination, "  pad: %i, %i, %i, %i\n", region->pads[0], region->pads[1], region->pads[2], region->pads[3]);
+	fprintf(destination, "  orig: %i, %i\n", region->originalWidth, region->originalHeight);
+	fprintf(destination, "  offset: %i, %i\n", region->offsetX, region->offsetY);
+	fprintf(destination, "  index: %i\n", region->index);
+}
+
 void TextureAtlas_write(TextureAtlas_atlas* atlas, const char* filename) {
 	FILE* destination = fopen(filename, "w");
 
 	if (destination == NULL)
 		return;
 
+	int nextLazyRegion = 0;
+	int nextCompactRegion = 0;
+
 	TextureAtlas_page* nextPage = atlas->firstPage;
 	while (nextPage != NULL) {
 		fprintf(destination, "\n");
@@ -268,20 +901,24 @@ void TextureAtlas_write(TextureAtlas_atlas* atlas, const char* filename) {
 		TextureAtlas_region* region = nextPage->firstRegion;
 
 		while (region != NULL) {
-			fprintf(destination, "%s\n", region->name);
-			fprintf(destination, "  rotate: %s\n", region->rotate ? "true" : "false");
-			fprintf(destination, "  xy: %i, %i\n", region->x, region->y);
-			fprintf(destination, "  size: %i, %i\n", region->width, region->height);
-			if (region->splits != NULL)
-				fprintf(destination, "  split: %i, %i, %i, %i\n", region->splits[0], region->splits[1], region->splits[2], region->splits[3]);
-			if (region->pads != NULL)
-				fprintf(destination, "  pad: %i, %i, %i, %i\n", region->pads[0], region->pads[1], region->pads[2], region->pads[3]);
-			fprintf(destination, "  orig: %i, %i\n", region->originalWidth, region->originalHeight);
-			fprintf(destination, "  offset: %i, %i\n", region->offsetX, region->offsetY);
-			fprintf(destination, "  index: %i\n", region->index);
-
+			write_region(destination, region);
 			region = region->nextRegion;
 		}
+
+		// Lazy and compact regions are stored in file order, so the ones belonging to this page come next
+		TextureAtlas_internal* internal = atlas->internal;
+		while (internal != NULL && nextLazyRegion < internal->numberOfLazyRegions && internal->lazyRegions[nextLazyRegion].page == nextPage) {
+			region = load_lazy_region(internal, &internal->lazyRegions[nextLazyRegion++]);
+			if (region != NULL)
+				write_region(destination, region);
+		}
+
+		while (internal != NULL && nextCompactRegion < internal->numberOfCompactRegions && internal->compactRegions[nextCompactRegion].page == nextPage->index) {
+			TextureAtlas_unpackedRegion unpacked;
+			unpack_region(internal, nextCompactRegion++, &unpacked);
+			write_region(destination, &unpacked.region);
+		}
+
 		nextPage = nextPage->next;
 	}
 
@@ -294,11 +931,61 @@ void TextureAtlas_cleanup(TextureAtlas_atlas* atlas) {
 
 		freePage(atlas->firstPage);
 
+		freeInternal(atlas->internal);
+
 		free(atlas);
 	}
 }
 
-TextureAtlas_atlas* TextureAtlas_read(const char* filename) {
+static TextureAtlas_atlas* create_atlas() {
+	// Create and initialize the atlas object we will be injecting data into
+	TextureAtlas_atlas* atlas = malloc(sizeof(TextureAtlas_atlas));
+	atlas->firstPage = NULL;
+	atlas->numberOfPages = 0;
+	atlas->internal = NULL;
+	return atlas;
+}
+
+static TextureAtlas_internal* create_internal(TextureAtlas_mode mode) {
+	TextureAtlas_internal* internal = calloc(1, sizeof(TextureAtlas_internal));
+	internal->mode = mode;
+	pthread_mutex_init(&internal->lock, NULL);
+	return internal;
+}
+
+/* Builds the name index of an eagerly read atlas, unless it has been built already.
+ * Done on the first lookup rather than while reading, so atlases nobody searches do not pay for it. */
+static void index_regions(TextureAtlas_atlas* atlas) {
+	TextureAtlas_internal* internal = atlas->internal;
+	if (__atomic_load_n(&internal->buckets, __ATOMIC_ACQUIRE) != NULL)
+		return;
+
+	pthread_mutex_lock(&internal->lock);
+
+	// Check again, someone may have built it while we waited for the lock
+	if (internal->buckets != NULL) {
+		pthread_mutex_unlock(&internal->lock);
+		return;
+	}
+
+	int capacity = 0;
+	for (TextureAtlas_page* page = atlas->firstPage; page != NULL; page = page->next) {
+		for (TextureAtlas_region* region = page->firstRegion; region != NULL; region = region->nextRegion) {
+			if (internal->numberOfRegions == capacity) {
+				capacity = capacity == 0 ? 256 : capacity * 2;
+				internal->regions = realloc(internal->regions, sizeof(TextureAtlas_region*) * capacity);
+			}
+			internal->regions[internal->numberOfRegions++] = region;
+		}
+	}
+
+	build_index(internal, internal->numberOfRegions);
+	__atomic_add_fetch(&internal->grownBytes, sizeof(TextureAtlas_bucket) * internal->numberOfBuckets + sizeof(TextureAtlas_region*) * internal->numberOfRegions, __ATOMIC_RELAXED);
+
+	pthread_mutex_unlock(&internal->lock);
+}
+
+static TextureAtlas_atlas* read_eager(const char* filename) {
 
 	FILE* atlasFile = fopen(filename, "r");
 
@@ -306,39 +993,31 @@ TextureAtlas_atlas* TextureAtlas_read(const char* filename) {
 	if (atlasFile == NULL)
 		return NULL;
 
-	// Create and initialize the atlas object we will be injecting data into
-	TextureAtlas_atlas* atlas = malloc(sizeof(TextureAtlas_atlas));
-	atlas->firstPage = NULL;
-	atlas->numberOfPages = 0;
+	TextureAtlas_atlas* atlas = create_atlas();
 
 	// Setup variables for reading lines
 	char* lineBuffer = calloc(BUFFER_SIZE, sizeof(char));
-	size_t bufferSize = 0;
+	size_t bufferSize = BUFFER_SIZE;
 	ssize_t charactersRead = 0;
+	char* absPathToDir = NULL;
 
 	charactersRead = getline(&lineBuffer, &bufferSize, atlasFile);
 
 	if (!is_new_page(charactersRead, lineBuffer)) {
-		return display_error(atlas, "ERROR. TextureAtlas: Expected atlas file to start with newline: '%s'.", filename);
+		display_error(NULL, "ERROR. TextureAtlas: Expected atlas file to start with newline: '%s'.", filename);
+		goto error;
 	}
 
 	// Keep track of the previous page, to allow creation of linked list of pages.
 	TextureAtlas_page* previousPage = NULL;
 
+	// Resolve the directory once, rather than for every page
+	absPathToDir = atlas_directory(filename);
+
 	bool keepScanningPages = true;
 	int nextPageIndex = 0;
 	while (keepScanningPages) {
-		// Create page, and initialized to a known invalid state
-		TextureAtlas_page* page = malloc(sizeof(TextureAtlas_page));
-		page->index = nextPageIndex++;
-		page->name = NULL;
-		page->next = NULL;
-		page->absolutePath = NULL;
-		page->width = page->height = -1;
-		page->format = TextureAtlas_UNDEFINED_FORMAT;
-		page->repeat = TextureAtlas_UNDEFINED_REPEAT;
-		page->minificationFilter = TextureAtlas_UNDEFINED_FILTER;
-		page->magnificationFilter = TextureAtlas_UNDEFINED_FILTER;
+		TextureAtlas_page* page = create_page(nextPageIndex++);
 
 		// Add the page to the atlas now, so we can free() it in case of an error triggering a cleanup
 		if (atlas->firstPage == NULL) {
@@ -353,15 +1032,14 @@ TextureAtlas_atlas* TextureAtlas_read(const char* filename) {
 		// Attempt to read the page name
 		charactersRead = getline(&lineBuffer, &bufferSize, atlasFile);
 		char* pageName = read_name(charactersRead, lineBuffer);
-		if (pageName == NULL)
-			return display_error(atlas, "ERROR. TextureAtlas: Could not find page name in file '%s'.", filename);
+		if (pageName == NULL) {
+			display_error(NULL, "ERROR. TextureAtlas: Could not find page name in file '%s'.", filename);
+			goto error;
+		}
 		page->name = pageName;
 
 		// Compute the absolute path to the page image
-		char* absPathToAtlas = realpath(filename, NULL);
-		char* absPathToDir = dirname(absPathToAtlas);
 		asprintf(&page->absolutePath, "%s/%s", absPathToDir, page->name);
-		free(absPathToAtlas);
 
 		while ((charactersRead = getline(&lineBuffer, &bufferSize, atlasFile)) > 0) {
 			char attribute[BUFFER_SIZE];
@@ -372,89 +1050,12 @@ TextureAtlas_atlas* TextureAtlas_read(const char* filename) {
 			if (!success)
 				break;
 
-			if (strcmp(attribute, "size") == 0) {
-				unsigned int width, height;
-				if (sscanf(value, "%u, %u", &width, &height) == 2) {
-					page->width = width;
-					page->height = width;
-				} else {
-					return display_error(atlas, "ERROR. TextureAtlas: Could not read two size tokens: '%s'\n", value);
-				}
-			} else if (strcmp(attribute, "format") == 0) {
-				if (strcmp(value, FORMAT_ALPHA) == 0) {
-					page->format = TextureAtlas_ALPHA;
-				} else if (strcmp(value, FORMAT_INTENSITY) == 0) {
-					page->format = TextureAtlas_INTENSITY;
-				} else if (strcmp(value, FORMAT_LUMINANCE_ALPHA) == 0) {
-					page->format = TextureAtlas_LUMINANCE_ALPHA;
-				} else if (strcmp(value, FORMAT_RGB565) == 0) {
-					page->format = TextureAtlas_RGB565;
-				} else if (strcmp(value, FORMAT_RGBA4444) == 0) {
-					page->format = TextureAtlas_RGBA4444;
-				} else if (strcmp(value, FORMAT_RGB888) == 0) {
-					page->format = TextureAtlas_RGB888;
-				} else if (strcmp(value, FORMAT_RGBA8888) == 0) {
-					page->format = TextureAtlas_RGBA8888;
-				} else {
-					return display_error(atlas, "ERROR. TextureAtlas: Unknown 'format' value: '%s'\n", value);
-				}
-			} else if (strcmp(attribute, "filter") == 0) {
-
-				/* Get the texture minification and magnification filters */
-				char* separator = strchr(value, ',');
-				if (separator != NULL) {
-					*separator = 0;
-					char* firstValue = value;
-					char* lastValue = separator + 1;
-
-					if (isspace(*lastValue))
-						lastValue++;
-
-					int lastLength = strlen(lastValue);
-					if (lastValue[lastLength - 1] == '\n') {
-						lastValue[lastLength - 1] = 0;
-					}
-
-					enum TextureAtlas_filter minFilter;
-					enum TextureAtlas_filter magFilter;
-					bool success = parse_filter_value(firstValue, &minFilter);
-					success = success && parse_filter_value(lastValue, &magFilter);
-
-					if (!success) {
-						TextureAtlas_cleanup(atlas);
-						return NULL;
-					}
-					page->minificationFilter = minFilter;
-					page->magnificationFilter = magFilter;
-				} else {
-					return display_error(atlas, "ERROR. TextureAtlas: Could not read two filter tokens: '%s'\n", value);
-				}
-			} else if (strcmp(attribute, "repeat") == 0) {
-				if (strcmp(value, REPEAT_X) == 0) {
-					page->repeat = TextureAtlas_X;
-				} else if (strcmp(value, REPEAT_Y) == 0) {
-					page->repeat = TextureAtlas_Y;
-				} else if (strcmp(value, REPEAT_XY) == 0) {
-					page->repeat = TextureAtlas_XY;
-				} else if (strcmp(value, REPEAT_NONE) == 0) {
-					page->repeat = TextureAtlas_NONE;
-				} else {
-					return display_error(atlas, "ERROR. TextureAtlas: Unknown 'repeat' value: '%s'\n", value);
-				}
-			}
+			if (!parse_page_attribute(page, attribute, value))
+				goto error;
 		}
 
-		// Check that every field in the page has been correctly initialized
-		if (page->name == NULL)
-			return display_error(atlas, "'name' value not set in TextureAtlas page in file: '%s'\n", filename);
-		if (page->width == -1 || page->height == -1)
-			return display_error(atlas, "'size' value not properly set in TextureAtlas page '%s' in file: '%s'.\n", page->name, filename);
-		if (page->format == TextureAtlas_UNDEFINED_FORMAT)
-			return display_error(atlas, "'format' value not properly set in TextureAtlas page '%s' in file: '%s'.\n", page->name, filename);
-		if (page->repeat == TextureAtlas_UNDEFINED_REPEAT)
-			return display_error(atlas, "'repeat' value not properly set in TextureAtlas page '%s' in file: '%s'.\n", page->name, filename);
-		if (page->minificationFilter == TextureAtlas_UNDEFINED_FILTER || page->magnificationFilter == TextureAtlas_UNDEFINED_FILTER)
-			return display_error(atlas, "'filter' value not properly set in TextureAtlas page '%s' in file: '%s'.\n", page->name, filename);
+		if (!validate_page(page, filename))
+			goto error;
 
 		previousPage = page;
 
@@ -463,23 +1064,7 @@ TextureAtlas_atlas* TextureAtlas_read(const char* filename) {
 		// Start scanning regions
 		bool keepScanningRegions = true;
 		while (keepScanningRegions) {
-			// Create region to fill, and initialize to known default/invalid state.
-			TextureAtlas_region* region = malloc(sizeof(TextureAtlas_region));
-			region->page = page;
-			region->name = NULL;
-			region->width = -1;
-			region->height = -1;
-			region->index = -1;
-			region->offsetX = -1;
-			region->offsetY = -1;
-			region->originalHeight = -1;
-			region->originalWidth = -1;
-			region->pads = NULL;
-			region->rotate = false;
-			region->splits = NULL;
-			region->x = -1;
-			region->y = -1;
-			region->nextRegion = NULL;
+			TextureAtlas_region* region = create_region(page);
 
 			// Setup this now, so it will be cleanup on an error
 			if (previousRegion == NULL) {
@@ -491,8 +1076,10 @@ TextureAtlas_atlas* TextureAtlas_read(const char* filename) {
 			// Attempt to read the page name
 			char* regionName = read_name(charactersRead, lineBuffer);
 
-			if (regionName == NULL)
-				return display_error(atlas, "ERROR. TextureAtlas: Expected region name in file '%s'.", filename);
+			if (regionName == NULL) {
+				display_error(NULL, "ERROR. TextureAtlas: Expected region name in file '%s'.", filename);
+				goto error;
+			}
 
 			region->name = regionName;
 
@@ -504,78 +1091,8 @@ TextureAtlas_atlas* TextureAtlas_read(const char* filename) {
 				if (!success)
 					break;
 
-				if (strcmp(attribute, "rotate") == 0) {
-					if (strcmp(value, "false") == 0) {
-						region->rotate = false;
-					} else if (strcmp(value, "true") == 0) {
-						region->rotate = true;
-					} else {
-						return display_error(atlas, "ERROR. TextureAtlas: Unknown value in 'rotate' token: '%s'\n", value);
-					}
-				} else if (strcmp(attribute, REPEAT_XY) == 0) {
-					unsigned int x, y;
-					if (sscanf(value, "%u, %u", &x, &y) == 2) {
-						region->x = x;
-						region->y = y;
-					} else {
-						return display_error(atlas, "ERROR. TextureAtlas: Could not read 'xy' token: '%s'\n", value);
-					}
-				} else if (strcmp(attribute, "size") == 0) {
-					unsigned int width, height;
-					if (sscanf(value, "%u, %u", &width, &height) == 2) {
-						region->width = width;
-						region->height = height;
-					} else {
-						return display_error(atlas, "ERROR. TextureAtlas: Could not read 'size' token: '%s'\n", value);
-					}
-				} else if (strcmp(attribute, "orig") == 0) {
-					unsigned int width, height;
-					if (sscanf(value, "%u, %u", &width, &height) == 2) {
-						region->originalWidth = width;
-						region->originalHeight = height;
-					} else {
-						return display_error(atlas, "ERROR. TextureAtlas: Could not read 'orig' token: '%s'\n", value);
-					}
-				} else if (strcmp(attribute, "offset") == 0) {
-					unsigned int offsetX, offsetY;
-					if (sscanf(value, "%u, %u", &offsetX, &offsetY) == 2) {
-						region->offsetX = offsetX;
-						region->offsetY = offsetY;
-					} else {
-						return display_error(atlas, "ERROR. TextureAtlas: Could not read 'offset' token: '%s'\n", value);
-					}
-				} else if (strcmp(attribute, "index") == 0) {
-					unsigned int index;
-					if (sscanf(value, "%u", &index) == 1) {
-						region->index = index;
-					} else {
-						return display_error(atlas, "ERROR. TextureAtlas: Could not read 'index' token: '%s'\n", value);
-					}
-				} else if (strcmp(attribute, "split") == 0) {
-					unsigned int v1, v2, v3, v4;
-					if (sscanf(value, "%u, %u, %u, %u", &v1, &v2, &v3, &v4) == 4) {
-						int* splits = malloc(sizeof(int) * 4);
-						splits[0] = v1;
-						splits[1] = v2;
-						splits[2] = v3;
-						splits[3] = v4;
-						region->splits = splits;
-					} else {
-						return display_error(atlas, "ERROR. TextureAtlas: Could not read 'split' token: '%s'\n", value);
-					}
-				} else if (strcmp(attribute, "pad") == 0) {
-					unsigned int v1, v2, v3, v4;
-					if (sscanf(value, "%u, %u, %u, %u", &v1, &v2, &v3, &v4) == 4) {
-						int* pads = malloc(sizeof(int) * 4);
-						pads[0] = v1;
-						pads[1] = v2;
-						pads[2] = v3;
-						pads[3] = v4;
-						region->pads = pads;
-					} else {
-						return display_error(atlas, "ERROR. TextureAtlas: Could not read 'pad' token: '%s'\n", value);
-					}
-				}
+				if (!parse_region_attribute(region, attribute, value))
+					goto error;
 			}
 
 			// No more attributes - what did we hit instead?
@@ -595,11 +1112,483 @@ TextureAtlas_atlas* TextureAtlas_read(const char* filename) {
 	}
 	/* Deallocate temporary memory */
 	free(lineBuffer);
+	free(absPathToDir);
+	fclose(atlasFile);
+
+	atlas->internal = create_internal(TextureAtlas_EAGER);
+
+	return atlas;
+
+error:
+	free(lineBuffer);
+	free(absPathToDir);
+	fclose(atlasFile);
+	TextureAtlas_cleanup(atlas);
+	return NULL;
+}
+
+/* Maps the whole file into memory. Returns NULL if it could not be opened or mapped. */
+static char* map_file(const char* filename, size_t* size) {
+	int fileDescriptor = open(filename, O_RDONLY);
+
+	// If we could not open the file, return a NULL pointer and let the caller deal with it.
+	if (fileDescriptor == -1)
+		return NULL;
+
+	struct stat fileStatus;
+	if (fstat(fileDescriptor, &fileStatus) == -1 || fileStatus.st_size == 0) {
+		close(fileDescriptor);
+		return display_error(NULL, "ERROR. TextureAtlas: Expected atlas file to start with newline: '%s'.", filename);
+	}
+
+	char* data = mmap(NULL, fileStatus.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	close(fileDescriptor);
+
+	if (data == MAP_FAILED)
+		return display_error(NULL, "ERROR. TextureAtlas: Could not map file '%s'.", filename);
+
+	*size = fileStatus.st_size;
+	return data;
+}
+
+/* Parses the page name and header attributes from a buffer. On return 'line' holds the first line after the header. */
+static bool parse_page_header(char** cursor, char* end, TextureAtlas_page* page, const char* absPathToDir, const char* filename, char** line, ssize_t* charactersRead, bool* haveLine) {
+	// Attempt to read the page name
+	*haveLine = next_line(cursor, end, line, charactersRead);
+	page->name = read_name(*haveLine ? *charactersRead : -1, *line);
+	if (page->name == NULL)
+		return display_error(NULL, "ERROR. TextureAtlas: Could not find page name in file '%s'.", filename);
+
+	asprintf(&page->absolutePath, "%s/%s", absPathToDir, page->name);
+
+	while ((*haveLine = next_line(cursor, end, line, charactersRead))) {
+		char lineBuffer[BUFFER_SIZE];
+		char attribute[BUFFER_SIZE];
+		char value[BUFFER_SIZE];
+
+		ssize_t lineLength = *charactersRead;
+		copy_line(*line, &lineLength, lineBuffer);
+		if (!parse_attribute(lineLength, lineBuffer, attribute, value, 0))
+			break;
+
+		if (!parse_page_attribute(page, attribute, value))
+			return false;
+	}
+
+	return validate_page(page, filename);
+}
+
+/* Maps the file, parses the page headers and records where each region is, without parsing them. */
+static TextureAtlas_atlas* scan_regions(const char* filename) {
+	size_t dataSize = 0;
+	char* data = map_file(filename, &dataSize);
+	if (data == NULL)
+		return NULL;
+
+	TextureAtlas_atlas* atlas = create_atlas();
+
+	TextureAtlas_internal* internal = create_internal(TextureAtlas_LAZY);
+	internal->data = data;
+	internal->dataSize = dataSize;
+	atlas->internal = internal;
+
+	char* cursor = data;
+	char* end = data + internal->dataSize;
+	char* line = NULL;
+	ssize_t charactersRead = -1;
+
+	if (!next_line(&cursor, end, &line, &charactersRead) || !is_new_page(charactersRead, line))
+		return display_error(atlas, "ERROR. TextureAtlas: Expected atlas file to start with newline: '%s'.", filename);
+
+	// Resolve the directory once, rather than for every page
+	char* absPathToDir = atlas_directory(filename);
+
+	int capacity = 0;
+	TextureAtlas_page* previousPage = NULL;
+	bool keepScanningPages = true;
+
+	while (keepScanningPages) {
+		TextureAtlas_page* page = create_page(atlas->numberOfPages++);
+
+		if (atlas->firstPage == NULL) {
+			atlas->firstPage = page;
+		} else {
+			previousPage->next = page;
+		}
+		previousPage = page;
+
+		// The page header is small, so parse it right away
+		bool haveLine;
+		if (!parse_page_header(&cursor, end, page, absPathToDir, filename, &line, &charactersRead, &haveLine)) {
+			free(absPathToDir);
+			TextureAtlas_cleanup(atlas);
+			return NULL;
+		}
+
+		// Every page needs at least one region, like the eager reader demands
+		if (!haveLine || is_new_page(charactersRead, line)) {
+			free(absPathToDir);
+			return display_error(atlas, "ERROR. TextureAtlas: Expected region name in file '%s'.", filename);
+		}
+
+		// Only record where each region is. A region ends at the first line that is not an attribute,
+		// which starts a new region or page, the same as in the eager reader.
+		while (true) {
+			if (!haveLine || is_new_page(charactersRead, line)) {
+				keepScanningPages = haveLine;
+				break;
+			}
+
+			if (internal->numberOfLazyRegions == capacity) {
+				capacity = capacity == 0 ? 256 : capacity * 2;
+				internal->lazyRegions = realloc(internal->lazyRegions, sizeof(TextureAtlas_lazyRegion) * capacity);
+			}
+
+			TextureAtlas_lazyRegion* lazyRegion = &internal->lazyRegions[internal->numberOfLazyRegions++];
+			lazyRegion->page = page;
+			lazyRegion->nameOffset = line - data;
+			lazyRegion->nameLength = line[charactersRead - 1] == '\n' ? charactersRead - 1 : charactersRead;
+			lazyRegion->failed = false;
+			lazyRegion->region = NULL;
+
+			while ((haveLine = next_line(&cursor, end, &line, &charactersRead))) {
+				char lineBuffer[BUFFER_SIZE];
+				char attribute[BUFFER_SIZE];
+				char value[BUFFER_SIZE];
+
+				ssize_t lineLength = charactersRead;
+				copy_line(line, &lineLength, lineBuffer);
+				if (!parse_attribute(lineLength, lineBuffer, attribute, value, 2))
+					break;
+			}
+
+			lazyRegion->end = haveLine ? (size_t) (line - data) : internal->dataSize;
+		}
+	}
+
+	free(absPathToDir);
 
+	internal->lazyRegions = realloc(internal->lazyRegions, sizeof(TextureAtlas_lazyRegion) * internal->numberOfLazyRegions);
+
+	return atlas;
+}
+
+static TextureAtlas_atlas* read_lazy(const char* filename) {
+	TextureAtlas_atlas* atlas = scan_regions(filename);
+	if (atlas != NULL)
+		build_index(atlas->internal, atlas->internal->numberOfLazyRegions);
 	return atlas;
 }
 
+typedef struct TextureAtlas_pageJob {
+	/* The part of the file holding the page, without the blank lines around it. */
+	char* start;
+	char* end;
+
+	/* The page to fill, already linked into the atlas. */
+	TextureAtlas_page* page;
+
+	bool success;
+} TextureAtlas_pageJob;
+
+typedef struct TextureAtlas_pageJobs {
+	TextureAtlas_pageJob* jobs;
+	int numberOfJobs;
+
+	/* The next job to take. Workers take jobs until there are none left. */
+	int nextJob;
+
+	const char* absPathToDir;
+	const char* filename;
+} TextureAtlas_pageJobs;
+
+/* Parses a page and all its regions from its part of the file. */
+static bool parse_page(TextureAtlas_pageJob* job, const char* absPathToDir, const char* filename) {
+	TextureAtlas_page* page = job->page;
+	char* cursor = job->start;
+	char* line = NULL;
+	ssize_t charactersRead = -1;
+	bool haveLine;
+
+	if (!parse_page_header(&cursor, job->end, page, absPathToDir, filename, &line, &charactersRead, &haveLine))
+		return false;
+
+	if (!haveLine)
+		return display_error(NULL, "ERROR. TextureAtlas: Expected region name in file '%s'.", filename);
+
+	TextureAtlas_region* previousRegion = NULL;
+
+	while (haveLine) {
+		TextureAtlas_region* region = create_region(page);
+
+		// Setup this now, so it will be cleanup on an error
+		if (previousRegion == NULL) {
+			page->firstRegion = region;
+		} else {
+			previousRegion->nextRegion = region;
+		}
+		previousRegion = region;
+
+		region->name = read_name(charactersRead, line);
+		if (region->name == NULL)
+			return display_error(NULL, "ERROR. TextureAtlas: Expected region name in file '%s'.", filename);
+
+		while ((haveLine = next_line(&cursor, job->end, &line, &charactersRead))) {
+			char lineBuffer[BUFFER_SIZE];
+			char attribute[BUFFER_SIZE];
+			char value[BUFFER_SIZE];
+
+			ssize_t lineLength = charactersRead;
+			copy_line(line, &lineLength, lineBuffer);
+			if (!parse_attribute(lineLength, lineBuffer, attribute, value, 2))
+				break;
+
+			if (!parse_region_attribute(region, attribute, value))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void* parse_pages(void* argument) {
+	TextureAtlas_pageJobs* pageJobs = argument;
+
+	int job;
+	while ((job = __atomic_fetch_add(&pageJobs->nextJob, 1, __ATOMIC_RELAXED)) < pageJobs->numberOfJobs)
+		pageJobs->jobs[job].success = parse_page(&pageJobs->jobs[job], pageJobs->absPathToDir, pageJobs->filename);
+
+	return NULL;
+}
+
+static TextureAtlas_atlas* read_parallel(const char* filename) {
+	size_t dataSize = 0;
+	char* data = map_file(filename, &dataSize);
+	if (data == NULL)
+		return NULL;
+
+	if (data[0] != '\n') {
+		munmap(data, dataSize);
+		return display_error(NULL, "ERROR. TextureAtlas: Expected atlas file to start with newline: '%s'.", filename);
+	}
+
+	// Pages are separated by blank lines, so split the file at every pair of newlines
+	TextureAtlas_pageJobs pageJobs = { NULL, 0, 0, NULL, filename };
+	int capacity = 0;
+	char* end = data + dataSize;
+	char* start = data + 1;
+
+	while (start != NULL) {
+		char* separator = memmem(start, end - start, "\n\n", 2);
+
+		if (pageJobs.numberOfJobs == capacity) {
+			capacity = capacity == 0 ? 16 : capacity * 2;
+			pageJobs.jobs = realloc(pageJobs.jobs, sizeof(TextureAtlas_pageJob) * capacity);
+		}
+
+		TextureAtlas_pageJob* job = &pageJobs.jobs[pageJobs.numberOfJobs++];
+		job->start = start;
+		job->end = separator != NULL ? separator + 1 : end;
+		job->success = false;
+
+		start = separator != NULL ? separator + 2 : NULL;
+	}
+
+	// Create and link the pages up front, so they are in file order no matter which thread parses them
+	TextureAtlas_atlas* atlas = create_atlas();
+	TextureAtlas_page* previousPage = NULL;
+	for (int i = 0; i < pageJobs.numberOfJobs; i++) {
+		TextureAtlas_page* page = create_page(atlas->numberOfPages++);
+
+		if (atlas->firstPage == NULL) {
+			atlas->firstPage = page;
+		} else {
+			previousPage->next = page;
+		}
+		previousPage = page;
+
+		pageJobs.jobs[i].page = page;
+	}
+
+	// Resolve the directory once, rather than for every page
+	char* absPathToDir = atlas_directory(filename);
+	pageJobs.absPathToDir = absPathToDir;
+
+	long numberOfThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numberOfThreads > pageJobs.numberOfJobs)
+		numberOfThreads = pageJobs.numberOfJobs;
+
+	// The calling thread works as well, so start one thread less
+	pthread_t* threads = malloc(sizeof(pthread_t) * (numberOfThreads > 1 ? numberOfThreads - 1 : 1));
+	int numberOfStartedThreads = 0;
+	for (int i = 0; i < numberOfThreads - 1; i++)
+		if (pthread_create(&threads[numberOfStartedThreads], NULL, parse_pages, &pageJobs) == 0)
+			numberOfStartedThreads++;
+
+	parse_pages(&pageJobs);
+
+	for (int i = 0; i < numberOfStartedThreads; i++)
+		pthread_join(threads[i], NULL);
+
+	bool success = true;
+	for (int i = 0; i < pageJobs.numberOfJobs; i++)
+		success = success && pageJobs.jobs[i].success;
+
+	free(threads);
+	free(pageJobs.jobs);
+	free(absPathToDir);
+	munmap(data, dataSize);
+
+	if (!success) {
+		TextureAtlas_cleanup(atlas);
+		return NULL;
+	}
+
+	atlas->internal = create_internal(TextureAtlas_EAGER);
+
+	return atlas;
+}
+
+static void widen_values(TextureAtlas_internal* internal) {
+	int* wide = malloc(sizeof(int) * internal->valueCapacity);
+	unsigned short* narrow = internal->values;
+	for (size_t i = 0; i < internal->numberOfValues; i++)
+		wide[i] = (int) narrow[i] - 1;
+
+	free(internal->values);
+	internal->values = wide;
+	internal->wideValues = true;
+}
+
+static void append_value(TextureAtlas_internal* internal, int value) {
+	if (!internal->wideValues && (value < -1 || value > COMPACT_NARROW_MAX))
+		widen_values(internal);
+
+	size_t valueSize = internal->wideValues ? sizeof(int) : sizeof(unsigned short);
+	if (internal->numberOfValues == internal->valueCapacity) {
+		internal->valueCapacity = internal->valueCapacity * 3 / 2 + COMPACT_VALUES;
+		internal->values = realloc(internal->values, valueSize * internal->valueCapacity);
+	}
+
+	if (internal->wideValues)
+		((int*) internal->values)[internal->numberOfValues++] = value;
+	else
+		((unsigned short*) internal->values)[internal->numberOfValues++] = value + 1;
+}
+
+static TextureAtlas_atlas* read_compact(const char* filename) {
+	TextureAtlas_atlas* atlas = scan_regions(filename);
+	if (atlas == NULL)
+		return NULL;
+
+	TextureAtlas_internal* internal = atlas->internal;
+	if (atlas->numberOfPages > 65536)
+		return display_error(atlas, "ERROR. TextureAtlas: Too many pages for a compact atlas in file '%s'.\n", filename);
+
+	internal->pages = malloc(sizeof(TextureAtlas_page*) * atlas->numberOfPages);
+	for (TextureAtlas_page* page = atlas->firstPage; page != NULL; page = page->next) {
+		internal->pages[page->index] = page;
+
+		// Start out with 16 bit values if the pages are small enough. Anything larger widens the pool.
+		if (page->width > COMPACT_NARROW_MAX || page->height > COMPACT_NARROW_MAX)
+			internal->wideValues = true;
+	}
+
+	int numberOfRegions = internal->numberOfLazyRegions;
+	size_t stringPoolSize = 0;
+	for (int i = 0; i < numberOfRegions; i++)
+		stringPoolSize += internal->lazyRegions[i].nameLength + 1;
+
+	internal->compactRegions = malloc(sizeof(TextureAtlas_compactRegion) * numberOfRegions);
+	internal->stringPool = malloc(stringPoolSize);
+	internal->valueCapacity = (size_t) numberOfRegions * COMPACT_VALUES;
+	internal->values = malloc((internal->wideValues ? sizeof(int) : sizeof(unsigned short)) * internal->valueCapacity);
+
+	for (int i = 0; i < numberOfRegions; i++) {
+		TextureAtlas_region* region = parse_lazy_region(internal, &internal->lazyRegions[i]);
+		if (region == NULL) {
+			TextureAtlas_cleanup(atlas);
+			return NULL;
+		}
+
+		TextureAtlas_compactRegion* compactRegion = &internal->compactRegions[internal->numberOfCompactRegions++];
+		compactRegion->nameOffset = internal->stringPoolSize;
+		compactRegion->valueOffset = internal->numberOfValues;
+		compactRegion->page = region->page->index;
+		compactRegion->flags = (region->rotate ? COMPACT_ROTATE : 0) | (region->splits != NULL ? COMPACT_SPLITS : 0) | (region->pads != NULL ? COMPACT_PADS : 0);
+
+		size_t nameSize = strlen(region->name) + 1;
+		memcpy(internal->stringPool + internal->stringPoolSize, region->name, nameSize);
+		internal->stringPoolSize += nameSize;
+
+		int values[COMPACT_VALUES] = { region->x, region->y, region->width, region->height, region->originalWidth, region->originalHeight, region->offsetX, region->offsetY, region->index };
+		for (int j = 0; j < COMPACT_VALUES; j++)
+			append_value(internal, values[j]);
+		for (int j = 0; region->splits != NULL && j < 4; j++)
+			append_value(internal, region->splits[j]);
+		for (int j = 0; region->pads != NULL && j < 4; j++)
+			append_value(internal, region->pads[j]);
+
+		freeRegion(region);
+	}
+
+	// Trim the value pool, and let go of the file and the lazy bookkeeping
+	internal->valueCapacity = internal->numberOfValues;
+	internal->values = realloc(internal->values, (internal->wideValues ? sizeof(int) : sizeof(unsigned short)) * internal->valueCapacity);
+
+	free(internal->lazyRegions);
+	internal->lazyRegions = NULL;
+	internal->numberOfLazyRegions = 0;
+
+	munmap(internal->data, internal->dataSize);
+	internal->data = NULL;
+	internal->dataSize = 0;
+
+	internal->mode = TextureAtlas_COMPACT;
+	build_index(internal, internal->numberOfCompactRegions);
+
+	return atlas;
+}
+
+TextureAtlas_atlas* TextureAtlas_read(const char* filename) {
+	return TextureAtlas_readWithMode(filename, TextureAtlas_EAGER);
+}
+
+TextureAtlas_atlas* TextureAtlas_readWithMode(const char* filename, TextureAtlas_mode mode) {
+	if (mode == TextureAtlas_LAZY)
+		return read_lazy(filename);
+	else if (mode == TextureAtlas_COMPACT)
+		return read_compact(filename);
+	else if (mode == TextureAtlas_PARALLEL)
+		return read_parallel(filename);
+	else
+		return read_eager(filename);
+}
+
+/* The region with the number, or NULL for compact atlases as they have no region structures. */
+static TextureAtlas_region* indexed_region(TextureAtlas_internal* internal, int region) {
+	if (region == -1)
+		return NULL;
+	else if (internal->mode == TextureAtlas_LAZY)
+		return load_lazy_region(internal, &internal->lazyRegions[region]);
+	else if (internal->mode == TextureAtlas_EAGER)
+		return internal->regions[region];
+	else
+		return NULL;
+}
+
 TextureAtlas_region* TextureAtlas_findRegion(TextureAtlas_atlas* atlas, char* regionName) {
+	TextureAtlas_internal* internal = atlas->internal;
+	if (internal != NULL) {
+		if (internal->mode == TextureAtlas_COMPACT) {
+			display_error(NULL, "ERROR. TextureAtlas: Compact atlases have no region structures, use TextureAtlas_findCompactRegion.\n");
+			return NULL;
+		}
+		if (internal->mode == TextureAtlas_EAGER)
+			index_regions(atlas);
+		return indexed_region(internal, find_in_index(internal, regionName));
+	}
+
 	TextureAtlas_page* currentPage = atlas->firstPage;
 	while (currentPage != NULL) {
 		TextureAtlas_region* currentRegion = currentPage->firstRegion;
@@ -614,3 +1603,378 @@ TextureAtlas_region* TextureAtlas_findRegion(TextureAtlas_atlas* atlas, char* re
 	return NULL;
 }
 
+bool TextureAtlas_findCompactRegion(TextureAtlas_atlas* atlas, const char* regionName, TextureAtlas_unpackedRegion* unpacked) {
+	TextureAtlas_internal* internal = atlas->internal;
+	if (internal == NULL || internal->mode != TextureAtlas_COMPACT)
+		return display_error(NULL, "ERROR. TextureAtlas: Only compact atlases have compact regions, use TextureAtlas_findRegion.\n");
+
+	int region = find_in_index(internal, regionName);
+	if (region == -1)
+		return false;
+
+	unpack_region(internal, region, unpacked);
+	return true;
+}
+
+int TextureAtlas_findRegions(TextureAtlas_atlas* atlas, const char** regionNames, int numberOfNames, TextureAtlas_region** regions) {
+	TextureAtlas_internal* internal = atlas->internal;
+	if (internal != NULL && internal->mode == TextureAtlas_COMPACT) {
+		for (int i = 0; i < numberOfNames; i++)
+			regions[i] = NULL;
+		display_error(NULL, "ERROR. TextureAtlas: Compact atlases have no region structures, use TextureAtlas_findCompactRegions.\n");
+		return -1;
+	}
+
+	if (internal == NULL) {
+		int misses = 0;
+		for (int i = 0; i < numberOfNames; i++)
+			if ((regions[i] = TextureAtlas_findRegion(atlas, (char*) regionNames[i])) == NULL)
+				misses++;
+		return misses;
+	}
+
+	if (internal->mode == TextureAtlas_EAGER)
+		index_regions(atlas);
+
+	int* numbers = malloc(sizeof(int) * (numberOfNames > 0 ? numberOfNames : 1));
+	int misses = find_many_in_index(internal, regionNames, numberOfNames, numbers);
+	for (int i = 0; i < numberOfNames; i++)
+		regions[i] = indexed_region(internal, numbers[i]);
+	free(numbers);
+
+	return misses;
+}
+
+int TextureAtlas_findCompactRegions(TextureAtlas_atlas* atlas, const char** regionNames, int numberOfNames, TextureAtlas_unpackedRegion* unpacked) {
+	TextureAtlas_internal* internal = atlas->internal;
+	if (internal == NULL || internal->mode != TextureAtlas_COMPACT) {
+		for (int i = 0; i < numberOfNames; i++)
+			unpacked[i].region.name = NULL;
+		display_error(NULL, "ERROR. TextureAtlas: Only compact atlases have compact regions, use TextureAtlas_findRegions.\n");
+		return -1;
+	}
+
+	int* numbers = malloc(sizeof(int) * (numberOfNames > 0 ? numberOfNames : 1));
+	int misses = find_many_in_index(internal, regionNames, numberOfNames, numbers);
+	for (int i = 0; i < numberOfNames; i++) {
+		if (numbers[i] != -1)
+			unpack_region(internal, numbers[i], &unpacked[i]);
+		else
+			unpacked[i].region.name = NULL;
+	}
+	free(numbers);
+
+	return misses;
+}
+
+void TextureAtlas_reportMemory(TextureAtlas_atlas* atlas, TextureAtlas_memoryReport* report) {
+	memset(report, 0, sizeof(TextureAtlas_memoryReport));
+	if (atlas == NULL)
+		return;
+
+	report->pages = sizeof(TextureAtlas_atlas);
+
+	TextureAtlas_page* page = atlas->firstPage;
+	while (page != NULL) {
+		report->pages += sizeof(TextureAtlas_page);
+		if (page->name != NULL)
+			report->pages += strlen(page->name) + 1;
+		if (page->absolutePath != NULL)
+			report->pages += strlen(page->absolutePath) + 1;
+
+		TextureAtlas_region* region = page->firstRegion;
+		while (region != NULL) {
+			report_region(region, report);
+			region = region->nextRegion;
+		}
+		page = page->next;
+	}
+
+	TextureAtlas_internal* internal = atlas->internal;
+	if (internal != NULL) {
+		report->pages += sizeof(TextureAtlas_internal);
+		report->fileData = internal->dataSize;
+		report->regions += sizeof(TextureAtlas_lazyRegion) * internal->numberOfLazyRegions;
+
+		// Lock, since lookups may be building the index or parsing more regions right now
+		pthread_mutex_lock(&internal->lock);
+		report->index = sizeof(TextureAtlas_bucket) * internal->numberOfBuckets + sizeof(TextureAtlas_region*) * internal->numberOfRegions;
+		for (int i = 0; i < internal->numberOfLazyRegions; i++)
+			if (internal->lazyRegions[i].region != NULL)
+				report_region(internal->lazyRegions[i].region, report);
+		pthread_mutex_unlock(&internal->lock);
+
+		// Compact regions, with their splits and pads counted separately from the values every region has
+		size_t valueSize = internal->wideValues ? sizeof(int) : sizeof(unsigned short);
+		size_t regionValues = (size_t) internal->numberOfCompactRegions * COMPACT_VALUES;
+		report->pages += sizeof(TextureAtlas_page*) * (internal->pages != NULL ? atlas->numberOfPages : 0);
+		report->regions += sizeof(TextureAtlas_compactRegion) * internal->numberOfCompactRegions + valueSize * regionValues;
+		report->splitsAndPads += valueSize * (internal->numberOfValues - regionValues);
+		report->names += internal->stringPoolSize;
+	}
+
+	report->total = report->pages + report->regions + report->names + report->splitsAndPads + report->index + report->fileData;
+}
+
+size_t TextureAtlas_memoryUsage(TextureAtlas_atlas* atlas) {
+	TextureAtlas_memoryReport report;
+	TextureAtlas_reportMemory(atlas, &report);
+	return report.total;
+}
+
+/* Bytes the atlas has allocated for lookups since it was read. */
+static size_t grown_bytes(TextureAtlas_atlas* atlas) {
+	if (atlas->internal == NULL)
+		return 0;
+	return __atomic_load_n(&atlas->internal->grownBytes, __ATOMIC_RELAXED);
+}
+
+typedef enum TextureAtlas_entryState {
+	TextureAtlas_LOADING, TextureAtlas_READY, TextureAtlas_FAILED
+} TextureAtlas_entryState;
+
+typedef struct TextureAtlas_registryEntry {
+	/* Canonical path of the atlas file, used as the key. */
+	char* path;
+
+	/* The shared atlas, or NULL while loading or if loading failed. */
+	TextureAtlas_atlas* atlas;
+
+	enum TextureAtlas_entryState state;
+
+	/* Number of handles handed out, including threads waiting for the load. */
+	int references;
+
+	/* Bytes used by the atlas, computed once it has been loaded and kept up to date on release. */
+	size_t memoryUsage;
+
+	/* The atlas' grown bytes already included in memoryUsage. */
+	size_t grownBytes;
+
+	/* Link to the next entry in the registry. */
+	struct TextureAtlas_registryEntry* next;
+
+	/* Links in the least recently used list. Only unreferenced, loaded entries are in it. */
+	struct TextureAtlas_registryEntry* lruPrevious;
+	struct TextureAtlas_registryEntry* lruNext;
+} TextureAtlas_registryEntry;
+
+struct TextureAtlas_registry {
+	pthread_mutex_t lock;
+
+	/* Signalled whenever an entry finishes loading. */
+	pthread_cond_t loaded;
+
+	/* Head of the linked list containing all entries. */
+	TextureAtlas_registryEntry* firstEntry;
+
+	/* Least recently used entry first, most recently used last. */
+	TextureAtlas_registryEntry* lruFirst;
+	TextureAtlas_registryEntry* lruLast;
+
+	/* Bytes used by all loaded atlases, referenced or not. */
+	size_t memoryUsage;
+
+	size_t memoryBudget;
+
+	/* The mode atlases are read with. */
+	enum TextureAtlas_mode mode;
+};
+
+static void lru_remove(TextureAtlas_registry* registry, TextureAtlas_registryEntry* entry) {
+	if (entry->lruPrevious != NULL)
+		entry->lruPrevious->lruNext = entry->lruNext;
+	else
+		registry->lruFirst = entry->lruNext;
+
+	if (entry->lruNext != NULL)
+		entry->lruNext->lruPrevious = entry->lruPrevious;
+	else
+		registry->lruLast = entry->lruPrevious;
+
+	entry->lruPrevious = entry->lruNext = NULL;
+}
+
+static void lru_append(TextureAtlas_registry* registry, TextureAtlas_registryEntry* entry) {
+	entry->lruNext = NULL;
+	entry->lruPrevious = registry->lruLast;
+
+	if (registry->lruLast != NULL)
+		registry->lruLast->lruNext = entry;
+	else
+		registry->lruFirst = entry;
+
+	registry->lruLast = entry;
+}
+
+static bool lru_contains(TextureAtlas_registry* registry, TextureAtlas_registryEntry* entry) {
+	return entry->lruPrevious != NULL || registry->lruFirst == entry;
+}
+
+/* Unlinks the entry from the registry and frees it, including its atlas. Must hold the lock. */
+static void remove_entry(TextureAtlas_registry* registry, TextureAtlas_registryEntry* entry) {
+	TextureAtlas_registryEntry** link = &registry->firstEntry;
+	while (*link != entry)
+		link = &(*link)->next;
+	*link = entry->next;
+
+	if (lru_contains(registry, entry))
+		lru_remove(registry, entry);
+
+	if (entry->state == TextureAtlas_READY)
+		registry->memoryUsage -= entry->memoryUsage;
+
+	TextureAtlas_cleanup(entry->atlas);
+	free(entry->path);
+	free(entry);
+}
+
+/* Evicts the least recently used atlases until the budget is met, or nothing more can go. */
+static void evict(TextureAtlas_registry* registry) {
+	while (registry->memoryUsage > registry->memoryBudget && registry->lruFirst != NULL)
+		remove_entry(registry, registry->lruFirst);
+}
+
+TextureAtlas_registry* TextureAtlas_createRegistry(size_t memoryBudget, TextureAtlas_mode mode) {
+	TextureAtlas_registry* registry = malloc(sizeof(TextureAtlas_registry));
+	pthread_mutex_init(&registry->lock, NULL);
+	pthread_cond_init(&registry->loaded, NULL);
+	registry->firstEntry = NULL;
+	registry->lruFirst = NULL;
+	registry->lruLast = NULL;
+	registry->memoryUsage = 0;
+	registry->memoryBudget = memoryBudget;
+	registry->mode = mode;
+	return registry;
+}
+
+void TextureAtlas_setMemoryBudget(TextureAtlas_registry* registry, size_t memoryBudget) {
+	pthread_mutex_lock(&registry->lock);
+	registry->memoryBudget = memoryBudget;
+	evict(registry);
+	pthread_mutex_unlock(&registry->lock);
+}
+
+TextureAtlas_atlas* TextureAtlas_acquire(TextureAtlas_registry* registry, const char* filename) {
+	char* path = realpath(filename, NULL);
+	if (path == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&registry->lock);
+
+	TextureAtlas_registryEntry* entry = registry->firstEntry;
+	while (entry != NULL && strcmp(entry->path, path) != 0)
+		entry = entry->next;
+
+	if (entry != NULL) {
+		free(path);
+
+		entry->references++;
+		if (lru_contains(registry, entry))
+			lru_remove(registry, entry);
+
+		// Someone else is already parsing the file, wait for them rather than parsing it twice
+		while (entry->state == TextureAtlas_LOADING)
+			pthread_cond_wait(&registry->loaded, &registry->lock);
+
+		TextureAtlas_atlas* atlas = entry->atlas;
+		if (entry->state == TextureAtlas_FAILED && --entry->references == 0)
+			remove_entry(registry, entry);
+
+		pthread_mutex_unlock(&registry->lock);
+		return atlas;
+	}
+
+	entry = malloc(sizeof(TextureAtlas_registryEntry));
+	entry->path = path;
+	entry->atlas = NULL;
+	entry->state = TextureAtlas_LOADING;
+	entry->references = 1;
+	entry->memoryUsage = 0;
+	entry->grownBytes = 0;
+	entry->lruPrevious = entry->lruNext = NULL;
+	entry->next = registry->firstEntry;
+	registry->firstEntry = entry;
+
+	// Parse without holding the lock, so other atlases can be acquired meanwhile
+	pthread_mutex_unlock(&registry->lock);
+	TextureAtlas_atlas* atlas = TextureAtlas_readWithMode(path, registry->mode);
+	size_t memoryUsage = TextureAtlas_memoryUsage(atlas);
+	pthread_mutex_lock(&registry->lock);
+
+	entry->atlas = atlas;
+	if (atlas != NULL) {
+		entry->state = TextureAtlas_READY;
+		entry->memoryUsage = memoryUsage;
+		entry->grownBytes = grown_bytes(atlas);
+		registry->memoryUsage += memoryUsage;
+		evict(registry);
+	} else {
+		entry->state = TextureAtlas_FAILED;
+		if (--entry->references == 0)
+			remove_entry(registry, entry);
+	}
+
+	pthread_cond_broadcast(&registry->loaded);
+	pthread_mutex_unlock(&registry->lock);
+
+	return atlas;
+}
+
+void TextureAtlas_release(TextureAtlas_registry* registry, TextureAtlas_atlas* atlas) {
+	if (atlas == NULL)
+		return;
+
+	pthread_mutex_lock(&registry->lock);
+
+	TextureAtlas_registryEntry* entry = registry->firstEntry;
+	while (entry != NULL && entry->atlas != atlas)
+		entry = entry->next;
+
+	if (entry == NULL) {
+		display_error(NULL, "ERROR. TextureAtlas: Released an atlas not owned by the registry.\n");
+	} else if (--entry->references == 0) {
+		// Atlases grow as regions are looked up, add what they grew by since we last looked
+		size_t grownBytes = grown_bytes(atlas);
+		entry->memoryUsage += grownBytes - entry->grownBytes;
+		registry->memoryUsage += grownBytes - entry->grownBytes;
+		entry->grownBytes = grownBytes;
+
+		lru_append(registry, entry);
+		evict(registry);
+	}
+
+	pthread_mutex_unlock(&registry->lock);
+}
+
+size_t TextureAtlas_registryMemoryUsage(TextureAtlas_registry* registry) {
+	pthread_mutex_lock(&registry->lock);
+	size_t memoryUsage = registry->memoryUsage;
+	pthread_mutex_unlock(&registry->lock);
+	return memoryUsage;
+}
+
+void TextureAtlas_reportRegistry(TextureAtlas_registry* registry, TextureAtlas_registryReporter reporter, void* userData) {
+	pthread_mutex_lock(&registry->lock);
+
+	TextureAtlas_registryEntry* entry = registry->firstEntry;
+	while (entry != NULL) {
+		if (entry->state == TextureAtlas_READY)
+			reporter(entry->path, entry->references, entry->memoryUsage, userData);
+		entry = entry->next;
+	}
+
+	pthread_mutex_unlock(&registry->lock);
+}
+
+void TextureAtlas_destroyRegistry(TextureAtlas_registry* registry) {
+	if (registry == NULL)
+		return;
+
+	while (registry->firstEntry != NULL)
+		remove_entry(registry, registry->firstEntry);
+
+	pthread_cond_destroy(&registry->loaded);
+	pthread_mutex_destroy(&registry->lock);
+	free(registry);
+}
@@ -24,6 +24,7 @@
 #define TEXTURE_ATLAS_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef enum TextureAtlas_format {
 	TextureAtlas_ALPHA,
@@ -51,12 +52,37 @@ typedef enum TextureAtlas_filter {
 	TextureAtlas_UNDEFINED_FILTER
 } TextureAtlas_filter;
 
+typedef enum TextureAtlas_mode {
+	/* Parse and validate every region while reading the file. */
+	TextureAtlas_EAGER,
+
+	/* Only parse page headers and record where each region is while reading the file.
+	 * A region is parsed the first time it is looked up with TextureAtlas_findRegion,
+	 * and the pages' region lists are left empty. The file stays mapped until cleanup. */
+	TextureAtlas_LAZY,
+
+	/* Pack every region into a compact record, with 16 bit values where they fit, inline
+	 * splits and pads, and names in a shared string pool. Regions are looked up with
+	 * TextureAtlas_findCompactRegion, and the pages' region lists are left empty.
+	 * Looking up a compact atlas with TextureAtlas_findRegion or TextureAtlas_findRegions, or any
+	 * other atlas with TextureAtlas_findCompactRegion or TextureAtlas_findCompactRegions, prints
+	 * an error and finds nothing; the batched lookups return -1. */
+	TextureAtlas_COMPACT,
+
+	/* Like TextureAtlas_EAGER, but the file is split at the blank lines between pages,
+	 * and the pages are parsed in parallel on one thread per processor. */
+	TextureAtlas_PARALLEL
+} TextureAtlas_mode;
+
 typedef struct TextureAtlas_atlas {
 	/* Pointer to memory containing the first page.*/
 	struct TextureAtlas_page* firstPage;
 
 	/* How many pages are in the atlas */
 	int numberOfPages;
+
+	/* Library internal state, depending on the mode the atlas was read with. */
+	struct TextureAtlas_internal* internal;
 } TextureAtlas_atlas;
 
 typedef struct TextureAtlas_page {
@@ -135,12 +161,104 @@ typedef struct TextureAtlas_region {
 	struct TextureAtlas_region* nextRegion;
 } TextureAtlas_region;
 
+/* A region unpacked from a compact atlas. The name points into the atlas, while the
+ * splits and pads point into this struct, so it must not be copied. */
+typedef struct TextureAtlas_unpackedRegion {
+	TextureAtlas_region region;
+
+	int splits[4];
+
+	int pads[4];
+} TextureAtlas_unpackedRegion;
+
+/* Bytes used by an atlas, by category. Allocator overhead is not included. */
+typedef struct TextureAtlas_memoryReport {
+	/* The atlas and page structures, page names and paths. */
+	size_t pages;
+
+	/* Region structures, or compact region records and their values. */
+	size_t regions;
+
+	/* Region names, or the string pool of a compact atlas. */
+	size_t names;
+
+	/* Ninepatch splits and pads. */
+	size_t splitsAndPads;
+
+	/* Hash index of the region names. */
+	size_t index;
+
+	/* The atlas file, kept mapped by lazy atlases. */
+	size_t fileData;
+
+	/* Sum of all of the above. */
+	size_t total;
+} TextureAtlas_memoryReport;
+
 TextureAtlas_atlas* TextureAtlas_read(const char* filename);
 
+TextureAtlas_atlas* TextureAtlas_readWithMode(const char* filename, TextureAtlas_mode mode);
+
+/* The first lookup on an eagerly read atlas builds a name index, which keeps pointing at the
+ * regions and their names. Do not rename or free regions after looking any of them up.
+ * Returns NULL for compact atlases, use TextureAtlas_findCompactRegion for them. */
 TextureAtlas_region* TextureAtlas_findRegion(TextureAtlas_atlas* atlas, char* regionName);
 
+/* Looks up many regions at once, which is a lot faster than looking them up one by one.
+ * Stores the region for each name in 'regions', or NULL if there is no such region.
+ * Returns the number of names that were not found.
+ * Compact atlases must use TextureAtlas_findCompactRegions; for them this returns -1. */
+int TextureAtlas_findRegions(TextureAtlas_atlas* atlas, const char** regionNames, int numberOfNames, TextureAtlas_region** regions);
+
+/* Unpacks the region with the name from a compact atlas. Returns false if there is no such region,
+ * or if the atlas is not compact. */
+bool TextureAtlas_findCompactRegion(TextureAtlas_atlas* atlas, const char* regionName, TextureAtlas_unpackedRegion* unpacked);
+
+/* TextureAtlas_findRegions for compact atlases. Regions that were not found get a NULL name.
+ * Returns -1 if the atlas is not compact. */
+int TextureAtlas_findCompactRegions(TextureAtlas_atlas* atlas, const char** regionNames, int numberOfNames, TextureAtlas_unpackedRegion* unpacked);
+
 void TextureAtlas_write(TextureAtlas_atlas* atlas, const char* filename);
 
 void TextureAtlas_cleanup(TextureAtlas_atlas* atlas);
 
+void TextureAtlas_reportMemory(TextureAtlas_atlas* atlas, TextureAtlas_memoryReport* report);
+
+/* Approximate number of bytes allocated for the atlas and everything it owns.
+ * Allocator overhead is not included. */
+size_t TextureAtlas_memoryUsage(TextureAtlas_atlas* atlas);
+
+/* A registry shares atlases between everyone reading the same file. Atlases are
+ * keyed on the canonical path of the file, and each file is only parsed once,
+ * even when several threads acquire it at the same time.
+ *
+ * Atlases nobody holds a reference to are kept in a least recently used list,
+ * and evicted once the registry holds more than 'memoryBudget' bytes. */
+typedef struct TextureAtlas_registry TextureAtlas_registry;
+
+/* Called once for every atlas in the registry by TextureAtlas_reportRegistry. */
+typedef void (*TextureAtlas_registryReporter)(const char* path, int references, size_t memoryUsage, void* userData);
+
+/* Atlases are read with the given mode. */
+TextureAtlas_registry* TextureAtlas_createRegistry(size_t memoryBudget, TextureAtlas_mode mode);
+
+/* Changes the budget, evicting unreferenced atlases right away if it is exceeded. */
+void TextureAtlas_setMemoryBudget(TextureAtlas_registry* registry, size_t memoryBudget);
+
+/* Returns a shared atlas for the file, or NULL if it could not be read.
+ * Every successful acquire must be matched by a TextureAtlas_release. */
+TextureAtlas_atlas* TextureAtlas_acquire(TextureAtlas_registry* registry, const char* filename);
+
+void TextureAtlas_release(TextureAtlas_registry* registry, TextureAtlas_atlas* atlas);
+
+/* Total number of bytes used by the atlases currently held by the registry. */
+size_t TextureAtlas_registryMemoryUsage(TextureAtlas_registry* registry);
+
+/* Reports every atlas in the registry. The registry is locked while reporting,
+ * so the reporter must not call back into it. */
+void TextureAtlas_reportRegistry(TextureAtlas_registry* registry, TextureAtlas_registryReporter reporter, void* userData);
+
+/* Frees the registry and every atlas in it. Handles still held become invalid. */
+void TextureAtlas_destroyRegistry(TextureAtlas_registry* registry);
+
 #endif /* TEXTURE_ATLAS_H_ */